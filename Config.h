@@ -61,6 +61,36 @@ public:
         return settings.value("CheckInterval", 3000).toInt();
     }
 
+    static int getRenderWorkerCount() {
+        QSettings settings("IMPJR", "IMPJR_Printer");
+        return settings.value("RenderWorkerCount", 0).toInt();
+    }
+
+    static int getRenderWorkerTimeout() {
+        QSettings settings("IMPJR", "IMPJR_Printer");
+        return settings.value("RenderWorkerTimeout", 60000).toInt();
+    }
+
+    static int getRenderCacheSize() {
+        QSettings settings("IMPJR", "IMPJR_Printer");
+        return settings.value("RenderCacheSizeMB", 0).toInt();
+    }
+
+    static bool getOverlayPageNumbers() {
+        QSettings settings("IMPJR", "IMPJR_Printer");
+        return settings.value("OverlayPageNumbers", false).toBool();
+    }
+
+    static bool getOverlayBanner() {
+        QSettings settings("IMPJR", "IMPJR_Printer");
+        return settings.value("OverlayBanner", false).toBool();
+    }
+
+    static QString getOverlayWatermark() {
+        QSettings settings("IMPJR", "IMPJR_Printer");
+        return settings.value("OverlayWatermark").toString();
+    }
+
     static QStringList getAvailablePrinters() {
         return QPrinterInfo::availablePrinterNames();
     }
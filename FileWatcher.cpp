@@ -2,6 +2,8 @@
 #include "PrinterSelectionDialog.h"
 #ifdef HAS_QTPDF
 #include "PdfPrinter.h"
+#include "RenderWorkerPool.h"
+#include "SpeculativeRenderer.h"
 #endif
 #include <QStandardPaths>
 #include <QDir>
@@ -75,6 +77,10 @@ void FileWatcher::processPdfFiles()
         qDebug() << "Processing PDF:" << file;
         processedFiles.append(fullPath);
 
+        if (!preflightResults.value(fullPath).isCurrent(fullPath))
+            preflightResults.insert(fullPath, PdfPreflight::scan(fullPath));
+        const PdfPreflight::Info preflight = preflightResults.value(fullPath);
+
         QStringList availablePrinters = Config::getAvailablePrinters();
         if (availablePrinters.isEmpty()) {
             QMessageBox::critical(mainWindow, "No Printer Available",
@@ -89,10 +95,36 @@ void FileWatcher::processPdfFiles()
         if (printerIndex >= 0)
             dialog.findChild<QComboBox*>()->setCurrentIndex(printerIndex);
 
+        if (preflight.valid)
+            dialog.setPageCount(preflight.pageCount());
+
+        // Thumbnails and the first full-resolution pages are rendered while the
+        // user decides. With the worker pool enabled, the workers render the
+        // thumbnails and full pages are left to the print job.
+        RenderWorkerPool *pool = RenderWorkerPool::instance();
+        SpeculativeRenderer *speculative = new SpeculativeRenderer(
+            fullPath, PrinterSelectionDialog::MaxThumbnails, PrinterSelectionDialog::ThumbnailHeight);
+        connect(speculative, &SpeculativeRenderer::pageCountKnown,
+                &dialog, &PrinterSelectionDialog::setPageCount);
+        connect(speculative, &SpeculativeRenderer::thumbnailReady,
+                &dialog, &PrinterSelectionDialog::setThumbnail);
+
+        if (pool) {
+            speculative->startWithPool(pool, preflight);
+        } else {
+            auto speculateFor = [speculative](const QString &printerName) {
+                speculative->setResolution(PdfPrinter::renderResolution(printerName));
+            };
+            speculateFor(dialog.getSelectedPrinter());
+            connect(&dialog, &PrinterSelectionDialog::printerChanged, speculative, speculateFor);
+            speculative->start(QThread::LowPriority);
+        }
+
         int result = dialog.exec();
 
         if (result == QDialog::Rejected) {
             qDebug() << "User cancelled print job";
+            speculative->cancel();
             if (QFile::exists(fullPath)) {
                 if (QFile::remove(fullPath))
                     qDebug() << "Cancelled PDF deleted:" << fullPath;
@@ -100,6 +132,7 @@ void FileWatcher::processPdfFiles()
                     qDebug() << "Failed to delete cancelled PDF:" << fullPath;
             }
             processedFiles.removeOne(fullPath);
+            preflightResults.remove(fullPath);
             continue;
         }
 
@@ -110,7 +143,18 @@ void FileWatcher::processPdfFiles()
 
         Config::setPrinterName(printerName);
 
-        bool success = PdfPrinter::printFile(fullPath, printerName, manual);
+        // Outstanding thumbnails must not compete with the job for workers.
+        QList<QSizeF> workerPageSizes;
+        if (pool) {
+            speculative->workerPageSizes(&workerPageSizes);
+            speculative->cancel();
+            speculative = nullptr;
+        }
+
+        bool success = PdfPrinter::printFile(fullPath, printerName, manual, preflight, speculative,
+                                             workerPageSizes);
+        if (speculative)
+            speculative->cancel();
 
         if (success) {
             qDebug() << "Printed successfully:" << fullPath;
@@ -125,6 +169,7 @@ void FileWatcher::processPdfFiles()
             }
 
             processedFiles.removeOne(fullPath);
+            preflightResults.remove(fullPath);
         } else {
             qDebug() << "Printing failed:" << fullPath;
             processedFiles.removeOne(fullPath);
@@ -135,6 +180,8 @@ void FileWatcher::processPdfFiles()
 
     if (processedFiles.size() > 50)
         processedFiles.clear();
+    if (preflightResults.size() > 50)
+        preflightResults.clear();
 
 #else
     qDebug() << "Qt PDF support not available. Cannot process PDF files.";
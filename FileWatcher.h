@@ -5,6 +5,8 @@
 #include <QFileSystemWatcher>
 #include <QTimer>
 #include <QWidget>
+#include <QHash>
+#include "PdfPreflight.h"
 
 class FileWatcher : public QObject
 {
@@ -24,6 +26,7 @@ private:
     QString tempFolder;
     QWidget *mainWindow;
     QStringList processedFiles;
+    QHash<QString, PdfPreflight::Info> preflightResults;
 };
 
 #endif
@@ -0,0 +1,90 @@
+#include "PageOverlay.h"
+#include "Config.h"
+#include <QPainter>
+#include <QPainterPath>
+#include <QDateTime>
+
+PageOverlay::PageOverlay(const QString &jobName, int pageCount)
+    : watermark(Config::getOverlayWatermark())
+    , pageNumbers(Config::getOverlayPageNumbers())
+    , pageCount(pageCount)
+    , numberPen(QColor(80, 80, 80))
+    , numberFontHeight(0)
+{
+    if (Config::getOverlayBanner())
+        banner = QString("%1  -  %2").arg(jobName, QDateTime::currentDateTime().toString("yyyy-MM-dd hh:mm"));
+}
+
+const QPicture &PageOverlay::layer(const QSize &size, bool decorated)
+{
+    const quint64 key = (quint64(decorated) << 63) | (quint64(size.width()) << 32) | quint32(size.height());
+    auto it = layers.constFind(key);
+    if (it != layers.constEnd())
+        return it.value();
+
+    QPicture picture;
+    QPainter painter(&picture);
+
+    QPen alignmentPen(QColor(250, 250, 250));
+    alignmentPen.setWidth(1);
+    painter.setPen(alignmentPen);
+    painter.drawLine(0, 0, size.width() - 1, size.height() - 1);
+
+    // Text is recorded as outlines so replay does not depend on the font
+    // resolution of the device the picture is played back on.
+    if (decorated && !watermark.isEmpty()) {
+        QFont font;
+        font.setPixelSize(qMax(1, size.height() / 12));
+        font.setBold(true);
+        QPainterPath path;
+        path.addText(0, 0, font, watermark);
+        painter.save();
+        painter.translate(size.width() / 2.0, size.height() / 2.0);
+        painter.rotate(-45);
+        painter.translate(-path.boundingRect().center());
+        // Translucent, since the overlay is painted over the page content.
+        painter.fillPath(path, QColor(128, 128, 128, 60));
+        painter.restore();
+    }
+
+    if (decorated && !banner.isEmpty()) {
+        QFont font;
+        font.setPixelSize(qMax(1, size.height() / 90));
+        QPainterPath path;
+        path.addText(0, 0, font, banner);
+        QRectF bounds = path.boundingRect();
+        painter.save();
+        painter.translate((size.width() - bounds.width()) / 2.0 - bounds.left(),
+                          size.height() / 100.0 - bounds.top());
+        painter.fillPath(path, QColor(80, 80, 80));
+        painter.restore();
+    }
+
+    painter.end();
+    picture.setBoundingRect(QRect(QPoint(0, 0), size));
+    return layers.insert(key, picture).value();
+}
+
+void PageOverlay::paint(QPainter &painter, const QRect &pageRect, int pageIndex)
+{
+    painter.drawPicture(pageRect.topLeft(), layer(pageRect.size(), true));
+
+    if (!pageNumbers)
+        return;
+
+    const int fontHeight = qMax(1, pageRect.height() / 80);
+    if (fontHeight != numberFontHeight) {
+        numberFont.setPixelSize(fontHeight);
+        numberFontHeight = fontHeight;
+    }
+    painter.setFont(numberFont);
+    painter.setPen(numberPen);
+    painter.drawText(QRect(pageRect.left(), pageRect.bottom() - 3 * fontHeight, pageRect.width(), 2 * fontHeight),
+                     Qt::AlignCenter, QString("%1 / %2").arg(pageIndex + 1).arg(pageCount));
+}
+
+// Filler pages only carry the alignment line; nothing is rasterized.
+void PageOverlay::paintBlank(QPainter &painter, const QRect &pageRect)
+{
+    painter.drawPicture(pageRect.topLeft(), layer(pageRect.size(), false));
+}
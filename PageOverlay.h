@@ -0,0 +1,37 @@
+#ifndef PAGEOVERLAY_H
+#define PAGEOVERLAY_H
+
+#include <QString>
+#include <QHash>
+#include <QPicture>
+#include <QFont>
+#include <QPen>
+
+class QPainter;
+
+// Per-job page decorations (alignment line, banner, watermark, page numbers).
+// The parts shared by every page are recorded once per page size into a
+// QPicture and replayed, so no pens, images or layouts are rebuilt per page.
+class PageOverlay
+{
+public:
+    PageOverlay(const QString &jobName, int pageCount);
+
+    void paint(QPainter &painter, const QRect &pageRect, int pageIndex);
+    void paintBlank(QPainter &painter, const QRect &pageRect);
+
+private:
+    const QPicture &layer(const QSize &size, bool decorated);
+
+    QString banner;
+    QString watermark;
+    bool pageNumbers;
+    int pageCount;
+
+    QHash<quint64, QPicture> layers;
+    QFont numberFont;
+    QPen numberPen;
+    int numberFontHeight;
+};
+
+#endif
@@ -0,0 +1,775 @@
+#include "PdfPreflight.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QSet>
+#include <QElapsedTimer>
+#include <QDebug>
+#include <cstring>
+#include <limits>
+#include <utility>
+#include <vector>
+
+namespace {
+
+const int MaxNestingDepth = 64;
+
+// Decoded xref and object streams are capped. qUncompress cannot stop
+// early, so the cap is enforced on the input using the worst deflate ratio.
+const qsizetype MaxDecodedStreamBytes = 64 * 1024 * 1024;
+const qsizetype MaxDeflateRatio = 1032;
+
+// Numbers come from the file; casting an out-of-range double is undefined.
+template <typename T>
+T toInteger(double value, T fallback)
+{
+    if (!(value >= double(std::numeric_limits<T>::min())
+          && value < double(std::numeric_limits<T>::max()) + 1.0))
+        return fallback;
+    return T(value);
+}
+
+struct PdfObject
+{
+    enum Type { Null, Boolean, Number, Name, String, Keyword, Array, Dictionary, Reference };
+
+    Type type = Null;
+    double number = 0;
+    QByteArray text;
+    int objectNumber = 0;
+    std::vector<PdfObject> items;
+    std::vector<std::pair<QByteArray, PdfObject>> entries;
+    qsizetype streamOffset = -1;
+
+    const PdfObject *get(const char *key) const
+    {
+        for (const auto &entry : entries) {
+            if (entry.first == key)
+                return &entry.second;
+        }
+        return nullptr;
+    }
+
+    bool isName(const char *name) const { return type == Name && text == name; }
+};
+
+bool isWhite(char c)
+{
+    return c == 0 || c == '\t' || c == '\n' || c == '\f' || c == '\r' || c == ' ';
+}
+
+bool isDelimiter(char c)
+{
+    return c == '(' || c == ')' || c == '<' || c == '>' || c == '[' || c == ']'
+           || c == '{' || c == '}' || c == '/' || c == '%';
+}
+
+class Parser
+{
+public:
+    // Offsets come from the file, so never start outside the buffer.
+    Parser(const QByteArray &buffer, qsizetype start)
+        : data(buffer.constData()), size(buffer.size()), pos(qBound<qsizetype>(0, start, buffer.size())) {}
+
+    void skipWhitespace()
+    {
+        while (pos < size) {
+            if (data[pos] == '%') {
+                while (pos < size && data[pos] != '\r' && data[pos] != '\n')
+                    ++pos;
+            } else if (isWhite(data[pos])) {
+                ++pos;
+            } else {
+                break;
+            }
+        }
+    }
+
+    QByteArray readToken()
+    {
+        skipWhitespace();
+        qsizetype start = pos;
+        while (pos < size && !isWhite(data[pos]) && !isDelimiter(data[pos]))
+            ++pos;
+        return QByteArray(data + start, pos - start);
+    }
+
+    bool readInteger(qint64 *value)
+    {
+        bool ok = false;
+        *value = readToken().toLongLong(&ok);
+        return ok;
+    }
+
+    bool skipKeyword(const char *keyword)
+    {
+        skipWhitespace();
+        qsizetype length = qsizetype(std::strlen(keyword));
+        if (pos + length > size || std::memcmp(data + pos, keyword, length) != 0)
+            return false;
+        pos += length;
+        return true;
+    }
+
+    // Consumes "<number> <generation> obj".
+    bool readObjectHeader(qint64 *number)
+    {
+        qint64 generation;
+        return readInteger(number) && readInteger(&generation) && skipKeyword("obj");
+    }
+
+    PdfObject readObject(int depth = 0)
+    {
+        PdfObject object;
+        skipWhitespace();
+        if (pos >= size || depth > MaxNestingDepth)
+            return object;
+
+        char c = data[pos];
+        if (c == '/') {
+            ++pos;
+            qsizetype start = pos;
+            while (pos < size && !isWhite(data[pos]) && !isDelimiter(data[pos]))
+                ++pos;
+            object.type = PdfObject::Name;
+            object.text = QByteArray(data + start, pos - start);
+        } else if (c == '<' && pos + 1 < size && data[pos + 1] == '<') {
+            pos += 2;
+            object.type = PdfObject::Dictionary;
+            forever {
+                skipWhitespace();
+                if (pos >= size)
+                    break;
+                if (data[pos] == '>' && pos + 1 < size && data[pos + 1] == '>') {
+                    pos += 2;
+                    break;
+                }
+                qsizetype before = pos;
+                PdfObject key = readObject(depth + 1);
+                if (key.type != PdfObject::Name) {
+                    if (pos == before)
+                        ++pos;
+                    continue;
+                }
+                object.entries.emplace_back(key.text, readObject(depth + 1));
+            }
+            readStreamStart(&object);
+        } else if (c == '<') {
+            while (pos < size && data[pos] != '>')
+                ++pos;
+            ++pos;
+            object.type = PdfObject::String;
+        } else if (c == '(') {
+            int nesting = 0;
+            for (; pos < size; ++pos) {
+                if (data[pos] == '\\')
+                    ++pos;
+                else if (data[pos] == '(')
+                    ++nesting;
+                else if (data[pos] == ')' && --nesting == 0)
+                    break;
+            }
+            ++pos;
+            object.type = PdfObject::String;
+        } else if (c == '[') {
+            ++pos;
+            object.type = PdfObject::Array;
+            forever {
+                skipWhitespace();
+                if (pos >= size)
+                    break;
+                if (data[pos] == ']') {
+                    ++pos;
+                    break;
+                }
+                qsizetype before = pos;
+                object.items.push_back(readObject(depth + 1));
+                if (pos == before)
+                    ++pos;
+            }
+        } else if (isDelimiter(c)) {
+            ++pos;
+        } else {
+            QByteArray token = readToken();
+            bool isInteger = false;
+            qint64 integer = token.toLongLong(&isInteger);
+            if (isInteger) {
+                object.type = PdfObject::Number;
+                object.number = double(integer);
+                // "N G R" is an indirect reference.
+                qsizetype afterNumber = pos;
+                bool generationOk = false;
+                readToken().toLongLong(&generationOk);
+                skipWhitespace();
+                if (generationOk && integer >= 0 && integer <= std::numeric_limits<int>::max()
+                    && pos < size && data[pos] == 'R'
+                    && (pos + 1 >= size || isWhite(data[pos + 1]) || isDelimiter(data[pos + 1]))) {
+                    ++pos;
+                    object.type = PdfObject::Reference;
+                    object.objectNumber = int(integer);
+                } else {
+                    pos = afterNumber;
+                }
+            } else {
+                bool isReal = false;
+                double real = token.toDouble(&isReal);
+                if (isReal) {
+                    object.type = PdfObject::Number;
+                    object.number = real;
+                } else if (token == "true" || token == "false") {
+                    object.type = PdfObject::Boolean;
+                    object.number = token == "true";
+                } else if (token != "null") {
+                    object.type = PdfObject::Keyword;
+                    object.text = token;
+                }
+            }
+        }
+        return object;
+    }
+
+private:
+    void readStreamStart(PdfObject *dictionary)
+    {
+        qsizetype afterDictionary = pos;
+        if (!skipKeyword("stream")) {
+            pos = afterDictionary;
+            return;
+        }
+        if (pos < size && data[pos] == '\r')
+            ++pos;
+        if (pos < size && data[pos] == '\n')
+            ++pos;
+        dictionary->streamOffset = pos;
+    }
+
+    const char *data;
+    qsizetype size;
+    qsizetype pos;
+};
+
+struct XrefEntry
+{
+    enum Type { Free, InFile, InObjectStream };
+
+    Type type = Free;
+    qint64 offset = 0;
+    int index = 0;
+};
+
+struct ObjectStream
+{
+    QByteArray data;
+    QHash<int, qint64> offsets;
+};
+
+class Document
+{
+public:
+    explicit Document(const QByteArray &fileData) : data(fileData) {}
+
+    bool readCrossReferences();
+    bool collectPages(QList<PdfPreflight::Page> *pages);
+
+private:
+    struct Inherited {
+        const PdfObject *mediaBox = nullptr;
+        const PdfObject *cropBox = nullptr;
+        const PdfObject *rotate = nullptr;
+    };
+
+    bool readSection(qint64 offset, PdfObject *sectionTrailer, QHash<int, XrefEntry> *entries);
+    bool readTable(Parser &parser, PdfObject *sectionTrailer, QHash<int, XrefEntry> *entries);
+    bool readXrefStream(const PdfObject &dictionary, QHash<int, XrefEntry> *entries);
+    void addEntry(int number, const XrefEntry &entry);
+
+    PdfObject object(int number);
+    PdfObject resolve(const PdfObject &value);
+    QByteArray streamData(const PdfObject &dictionary, const QByteArray &source);
+    const ObjectStream *objectStream(int number);
+    void walk(const PdfObject &node, Inherited inherited, int depth,
+              QList<PdfPreflight::Page> *pages);
+    QRectF box(const PdfObject *value);
+
+    const QByteArray &data;
+    QHash<int, XrefEntry> xref;
+    QHash<int, ObjectStream> objectStreams;
+    QSet<int> resolving;
+    QSet<int> visitedNodes;
+    PdfObject trailer;
+};
+
+void Document::addEntry(int number, const XrefEntry &entry)
+{
+    // Sections are read newest first, so the first entry seen wins.
+    if (!xref.contains(number))
+        xref.insert(number, entry);
+}
+
+bool Document::readCrossReferences()
+{
+    qsizetype tail = qMax<qsizetype>(0, data.size() - 2048);
+    qsizetype marker = data.lastIndexOf("startxref");
+    if (marker < tail)
+        return false;
+
+    Parser parser(data, marker + 9);
+    qint64 offset = -1;
+    if (!parser.readInteger(&offset))
+        return false;
+
+    QSet<qint64> visited;
+    bool newest = true;
+    while (offset > 0 && offset < data.size() && !visited.contains(offset)) {
+        visited.insert(offset);
+
+        PdfObject sectionTrailer;
+        QHash<int, XrefEntry> entries;
+        if (!readSection(offset, &sectionTrailer, &entries))
+            return !newest && !xref.isEmpty();
+
+        if (newest)
+            trailer = sectionTrailer;
+        newest = false;
+
+        // Hybrid files keep the compressed objects in a separate xref stream.
+        // Its entries belong to the same section and replace the table's
+        // free entries, which only exist to hide them from older readers.
+        const PdfObject *hybrid = sectionTrailer.get("XRefStm");
+        if (hybrid && hybrid->type == PdfObject::Number && hybrid->number > 0
+            && hybrid->number < data.size() && !visited.contains(qint64(hybrid->number))) {
+            visited.insert(qint64(hybrid->number));
+            PdfObject ignored;
+            QHash<int, XrefEntry> streamEntries;
+            readSection(qint64(hybrid->number), &ignored, &streamEntries);
+            for (auto it = streamEntries.cbegin(); it != streamEntries.cend(); ++it) {
+                if (it.value().type != XrefEntry::Free && entries.value(it.key()).type == XrefEntry::Free)
+                    entries.insert(it.key(), it.value());
+            }
+        }
+
+        for (auto it = entries.cbegin(); it != entries.cend(); ++it)
+            addEntry(it.key(), it.value());
+
+        const PdfObject *prev = sectionTrailer.get("Prev");
+        offset = (prev && prev->type == PdfObject::Number) ? toInteger<qint64>(prev->number, -1) : -1;
+    }
+
+    return trailer.get("Root") != nullptr;
+}
+
+bool Document::readSection(qint64 offset, PdfObject *sectionTrailer, QHash<int, XrefEntry> *entries)
+{
+    Parser parser(data, offset);
+    if (parser.skipKeyword("xref"))
+        return readTable(parser, sectionTrailer, entries);
+
+    parser = Parser(data, offset);
+    qint64 number;
+    if (!parser.readObjectHeader(&number))
+        return false;
+
+    PdfObject dictionary = parser.readObject();
+    const PdfObject *type = dictionary.get("Type");
+    if (!type || !type->isName("XRef") || dictionary.streamOffset < 0)
+        return false;
+
+    *sectionTrailer = dictionary;
+    return readXrefStream(dictionary, entries);
+}
+
+bool Document::readTable(Parser &parser, PdfObject *sectionTrailer, QHash<int, XrefEntry> *entries)
+{
+    forever {
+        if (parser.skipKeyword("trailer")) {
+            *sectionTrailer = parser.readObject();
+            return sectionTrailer->type == PdfObject::Dictionary;
+        }
+
+        qint64 first, count;
+        if (!parser.readInteger(&first) || !parser.readInteger(&count) || first < 0 || count < 0
+            || first > std::numeric_limits<int>::max() - count)
+            return false;
+
+        for (qint64 i = 0; i < count; ++i) {
+            qint64 offset, generation;
+            if (!parser.readInteger(&offset) || !parser.readInteger(&generation))
+                return false;
+            QByteArray kind = parser.readToken();
+
+            XrefEntry entry;
+            if (kind == "n") {
+                entry.type = XrefEntry::InFile;
+                entry.offset = offset;
+            } else if (kind != "f") {
+                return false;
+            }
+            entries->insert(int(first + i), entry);
+        }
+    }
+}
+
+bool Document::readXrefStream(const PdfObject &dictionary, QHash<int, XrefEntry> *entries)
+{
+    const PdfObject *w = dictionary.get("W");
+    if (!w || w->type != PdfObject::Array || w->items.size() != 3)
+        return false;
+
+    int widths[3];
+    for (int i = 0; i < 3; ++i) {
+        widths[i] = toInteger<int>(w->items[i].number, -1);
+        if (widths[i] < 0 || widths[i] > 8)
+            return false;
+    }
+    const int rowSize = widths[0] + widths[1] + widths[2];
+    if (rowSize == 0)
+        return false;
+
+    QList<QPair<qint64, qint64>> subsections;
+    const PdfObject *index = dictionary.get("Index");
+    if (index && index->type == PdfObject::Array) {
+        for (size_t i = 0; i + 1 < index->items.size(); i += 2)
+            subsections.append(qMakePair(qint64(toInteger<int>(index->items[i].number, -1)),
+                                         qint64(toInteger<int>(index->items[i + 1].number, -1))));
+    } else {
+        const PdfObject *size = dictionary.get("Size");
+        subsections.append(qMakePair(qint64(0), size ? qint64(toInteger<int>(size->number, 0)) : qint64(0)));
+    }
+
+    QByteArray rows = streamData(dictionary, data);
+    const uchar *row = reinterpret_cast<const uchar *>(rows.constData());
+    const uchar *end = row + rows.size();
+
+    // Eight-byte fields can exceed qint64; those come back as -1, which no
+    // caller accepts as an offset or object number.
+    auto field = [&](int which, qint64 fallback) -> qint64 {
+        if (widths[which] == 0)
+            return fallback;
+        quint64 value = 0;
+        int skip = 0;
+        for (int i = 0; i < which; ++i)
+            skip += widths[i];
+        for (int i = 0; i < widths[which]; ++i)
+            value = (value << 8) | row[skip + i];
+        return value > quint64(std::numeric_limits<qint64>::max()) ? -1 : qint64(value);
+    };
+
+    for (const auto &subsection : subsections) {
+        if (subsection.first < 0 || subsection.second < 0
+            || subsection.first > std::numeric_limits<int>::max() - subsection.second)
+            return false;
+        for (qint64 i = 0; i < subsection.second; ++i, row += rowSize) {
+            if (row + rowSize > end)
+                return !entries->isEmpty();
+
+            XrefEntry entry;
+            switch (field(0, 1)) {
+            case 1:
+                entry.type = XrefEntry::InFile;
+                entry.offset = field(1, 0);
+                break;
+            case 2:
+                entry.type = XrefEntry::InObjectStream;
+                entry.offset = field(1, 0);
+                entry.index = int(qBound<qint64>(-1, field(2, 0), std::numeric_limits<int>::max()));
+                break;
+            default:
+                break;
+            }
+            entries->insert(int(subsection.first + i), entry);
+        }
+    }
+    return true;
+}
+
+// Reverses the PNG row predictors (10-15) that xref and object streams use.
+QByteArray unpredict(const QByteArray &input, int columns, int colors, int bitsPerComponent)
+{
+    const int bytesPerPixel = qMax(1, colors * bitsPerComponent / 8);
+    const int rowBytes = (columns * colors * bitsPerComponent + 7) / 8;
+    if (rowBytes <= 0)
+        return QByteArray();
+
+    QByteArray output;
+    output.reserve(input.size());
+    QByteArray previous(rowBytes, '\0');
+    const uchar *in = reinterpret_cast<const uchar *>(input.constData());
+    qsizetype remaining = input.size();
+
+    while (remaining >= rowBytes + 1) {
+        const int filter = *in++;
+        QByteArray current(reinterpret_cast<const char *>(in), rowBytes);
+        uchar *cur = reinterpret_cast<uchar *>(current.data());
+        const uchar *up = reinterpret_cast<const uchar *>(previous.constData());
+
+        for (int i = 0; i < rowBytes; ++i) {
+            const int left = i >= bytesPerPixel ? cur[i - bytesPerPixel] : 0;
+            const int upLeft = i >= bytesPerPixel ? up[i - bytesPerPixel] : 0;
+            switch (filter) {
+            case 1: cur[i] = uchar(cur[i] + left); break;
+            case 2: cur[i] = uchar(cur[i] + up[i]); break;
+            case 3: cur[i] = uchar(cur[i] + (left + up[i]) / 2); break;
+            case 4: {
+                const int p = left + up[i] - upLeft;
+                const int pa = qAbs(p - left), pb = qAbs(p - up[i]), pc = qAbs(p - upLeft);
+                cur[i] = uchar(cur[i] + ((pa <= pb && pa <= pc) ? left : (pb <= pc ? up[i] : upLeft)));
+                break;
+            }
+            default: break;
+            }
+        }
+
+        output.append(current);
+        previous = current;
+        in += rowBytes;
+        remaining -= rowBytes + 1;
+    }
+    return output;
+}
+
+QByteArray Document::streamData(const PdfObject &dictionary, const QByteArray &source)
+{
+    if (dictionary.streamOffset < 0 || dictionary.streamOffset > source.size())
+        return QByteArray();
+
+    qsizetype length = -1;
+    const PdfObject *lengthObject = dictionary.get("Length");
+    if (lengthObject) {
+        PdfObject value = resolve(*lengthObject);
+        if (value.type == PdfObject::Number)
+            length = toInteger<qsizetype>(value.number, -1);
+    }
+    if (length < 0 || dictionary.streamOffset + length > source.size()) {
+        qsizetype end = source.indexOf("endstream", dictionary.streamOffset);
+        if (end < 0)
+            return QByteArray();
+        length = end - dictionary.streamOffset;
+    }
+    QByteArray raw = source.mid(dictionary.streamOffset, length);
+
+    const PdfObject *filter = dictionary.get("Filter");
+    if (filter && filter->type == PdfObject::Array)
+        filter = filter->items.size() == 1 ? &filter->items.front() : nullptr;
+    if (!filter)
+        return dictionary.get("Filter") ? QByteArray() : raw;
+    if (!filter->isName("FlateDecode"))
+        return QByteArray();
+    if (raw.size() > MaxDecodedStreamBytes / MaxDeflateRatio) {
+        qDebug() << "Preflight skipped a compressed stream of" << raw.size() << "bytes";
+        return QByteArray();
+    }
+
+    // qUncompress wants a big-endian size hint in front of the zlib data and
+    // grows its buffer if the hint turns out to be too small.
+    const quint32 hint = quint32(qMin<qsizetype>(raw.size() * 4 + 64, 0x7fffffff));
+    QByteArray framed;
+    framed.reserve(raw.size() + 4);
+    framed.append(char(hint >> 24)).append(char(hint >> 16)).append(char(hint >> 8)).append(char(hint));
+    framed.append(raw);
+    QByteArray decoded = qUncompress(framed);
+    if (decoded.size() > MaxDecodedStreamBytes)
+        return QByteArray();
+
+    const PdfObject *parms = dictionary.get("DecodeParms");
+    if (parms && parms->type == PdfObject::Array)
+        parms = parms->items.empty() ? nullptr : &parms->items.front();
+    if (parms && parms->type == PdfObject::Dictionary) {
+        const PdfObject *predictor = parms->get("Predictor");
+        if (predictor && predictor->number >= 10) {
+            const PdfObject *columns = parms->get("Columns");
+            const PdfObject *colors = parms->get("Colors");
+            const PdfObject *bits = parms->get("BitsPerComponent");
+            // Bounded so the row size computed from them cannot overflow.
+            decoded = unpredict(decoded,
+                                columns ? qBound(1, toInteger<int>(columns->number, 1), 1 << 20) : 1,
+                                colors ? qBound(1, toInteger<int>(colors->number, 1), 32) : 1,
+                                bits ? qBound(1, toInteger<int>(bits->number, 8), 16) : 8);
+        } else if (predictor && predictor->number > 1) {
+            return QByteArray();
+        }
+    }
+    return decoded;
+}
+
+const ObjectStream *Document::objectStream(int number)
+{
+    auto it = objectStreams.constFind(number);
+    if (it != objectStreams.constEnd())
+        return &it.value();
+
+    PdfObject dictionary = object(number);
+    const PdfObject *count = dictionary.get("N");
+    const PdfObject *first = dictionary.get("First");
+    if (!count || !first || dictionary.streamOffset < 0)
+        return nullptr;
+
+    ObjectStream stream;
+    stream.data = streamData(dictionary, data);
+    const qint64 firstOffset = toInteger<qint64>(first->number, -1);
+    const int objectCount = toInteger<int>(count->number, 0);
+    Parser parser(stream.data, 0);
+    for (int i = 0; i < objectCount; ++i) {
+        qint64 objectNumber, offset;
+        if (!parser.readInteger(&objectNumber) || !parser.readInteger(&offset)
+            || objectNumber < 0 || objectNumber > std::numeric_limits<int>::max()
+            || offset < 0 || offset > stream.data.size()
+            || firstOffset < 0 || firstOffset > stream.data.size())
+            break;
+        stream.offsets.insert(int(objectNumber), firstOffset + offset);
+    }
+    return &objectStreams.insert(number, stream).value();
+}
+
+PdfObject Document::object(int number)
+{
+    auto it = xref.constFind(number);
+    if (it == xref.constEnd() || resolving.contains(number))
+        return PdfObject();
+
+    resolving.insert(number);
+    PdfObject result;
+    const XrefEntry entry = it.value();
+
+    if (entry.type == XrefEntry::InFile && entry.offset >= 0 && entry.offset < data.size()) {
+        Parser parser(data, entry.offset);
+        qint64 found;
+        if (parser.readObjectHeader(&found) && found == number)
+            result = parser.readObject();
+    } else if (entry.type == XrefEntry::InObjectStream && entry.offset >= 0
+               && entry.offset <= std::numeric_limits<int>::max()) {
+        const ObjectStream *stream = objectStream(int(entry.offset));
+        if (stream && stream->offsets.contains(number)) {
+            Parser parser(stream->data, stream->offsets.value(number));
+            result = parser.readObject();
+        }
+    }
+
+    resolving.remove(number);
+    return result;
+}
+
+PdfObject Document::resolve(const PdfObject &value)
+{
+    return value.type == PdfObject::Reference ? object(value.objectNumber) : value;
+}
+
+QRectF Document::box(const PdfObject *value)
+{
+    if (!value)
+        return QRectF();
+
+    PdfObject array = resolve(*value);
+    if (array.type != PdfObject::Array || array.items.size() != 4)
+        return QRectF();
+
+    double c[4];
+    for (int i = 0; i < 4; ++i)
+        c[i] = resolve(array.items[i]).number;
+    return QRectF(QPointF(qMin(c[0], c[2]), qMin(c[1], c[3])),
+                  QPointF(qMax(c[0], c[2]), qMax(c[1], c[3])));
+}
+
+void Document::walk(const PdfObject &node, Inherited inherited, int depth,
+                    QList<PdfPreflight::Page> *pages)
+{
+    if (node.type != PdfObject::Dictionary || depth > MaxNestingDepth)
+        return;
+
+    if (const PdfObject *media = node.get("MediaBox"))
+        inherited.mediaBox = media;
+    if (const PdfObject *crop = node.get("CropBox"))
+        inherited.cropBox = crop;
+    if (const PdfObject *rotate = node.get("Rotate"))
+        inherited.rotate = rotate;
+
+    const PdfObject *type = node.get("Type");
+    const PdfObject *kids = node.get("Kids");
+    if ((type && type->isName("Pages")) || (!type && kids)) {
+        if (!kids)
+            return;
+        PdfObject kidArray = resolve(*kids);
+        for (const PdfObject &kid : kidArray.items) {
+            if (kid.type != PdfObject::Reference || visitedNodes.contains(kid.objectNumber))
+                continue;
+            visitedNodes.insert(kid.objectNumber);
+            walk(object(kid.objectNumber), inherited, depth + 1, pages);
+        }
+        return;
+    }
+
+    PdfPreflight::Page page;
+    page.mediaBox = box(inherited.mediaBox);
+    if (page.mediaBox.isEmpty())
+        page.mediaBox = QRectF(0, 0, 612, 792);
+    page.cropBox = box(inherited.cropBox);
+    if (page.cropBox.isEmpty())
+        page.cropBox = page.mediaBox;
+    if (inherited.rotate) {
+        int rotation = toInteger<int>(resolve(*inherited.rotate).number, 0) % 360;
+        page.rotation = ((rotation + 360) % 360) / 90 * 90;
+    }
+    pages->append(page);
+}
+
+bool Document::collectPages(QList<PdfPreflight::Page> *pages)
+{
+    const PdfObject *rootRef = trailer.get("Root");
+    PdfObject root = rootRef ? resolve(*rootRef) : PdfObject();
+    const PdfObject *pagesRef = root.get("Pages");
+    if (!pagesRef || pagesRef->type != PdfObject::Reference)
+        return false;
+
+    visitedNodes.insert(pagesRef->objectNumber);
+    walk(object(pagesRef->objectNumber), Inherited(), 0, pages);
+    return !pages->isEmpty();
+}
+
+} // namespace
+
+QSizeF PdfPreflight::Page::pointSize() const
+{
+    QRectF visible = cropBox.intersected(mediaBox);
+    if (visible.isEmpty())
+        visible = mediaBox;
+    QSizeF size = visible.size();
+    if (rotation == 90 || rotation == 270)
+        size.transpose();
+    return size;
+}
+
+bool PdfPreflight::Info::isCurrent(const QString &filePath) const
+{
+    QFileInfo info(filePath);
+    return valid && info.size() == fileSize && info.lastModified() == lastModified;
+}
+
+PdfPreflight::Info PdfPreflight::scan(const QString &filePath)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    Info result;
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly))
+        return result;
+
+    QFileInfo fileInfo(file);
+    result.fileSize = fileInfo.size();
+    result.lastModified = fileInfo.lastModified();
+
+    uchar *mapped = file.map(0, file.size());
+    if (!mapped)
+        return result;
+
+    const QByteArray data = QByteArray::fromRawData(reinterpret_cast<const char *>(mapped), file.size());
+    Document document(data);
+    result.valid = document.readCrossReferences() && document.collectPages(&result.pages);
+    if (!result.valid)
+        result.pages.clear();
+
+    file.unmap(mapped);
+
+    qDebug() << "Preflight" << (result.valid ? "read" : "could not read") << filePath
+             << "- pages:" << result.pageCount() << "in" << timer.elapsed() << "ms";
+    return result;
+}
@@ -0,0 +1,36 @@
+#ifndef PDFPREFLIGHT_H
+#define PDFPREFLIGHT_H
+
+#include <QString>
+#include <QList>
+#include <QRectF>
+#include <QDateTime>
+
+// Reads the trailer, cross-reference sections and page tree of a PDF without
+// loading it into the PDF engine, to get page count and page geometry early.
+class PdfPreflight
+{
+public:
+    struct Page {
+        QRectF mediaBox;
+        QRectF cropBox;
+        int rotation = 0;
+
+        // Visible size in points, with /Rotate applied.
+        QSizeF pointSize() const;
+    };
+
+    struct Info {
+        bool valid = false;
+        qint64 fileSize = 0;
+        QDateTime lastModified;
+        QList<Page> pages;
+
+        int pageCount() const { return pages.size(); }
+        bool isCurrent(const QString &filePath) const;
+    };
+
+    static Info scan(const QString &filePath);
+};
+
+#endif
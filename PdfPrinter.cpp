@@ -1,28 +1,77 @@
 #include "PdfPrinter.h"
+#include "RenderWorkerPool.h"
+#include "SpeculativeRenderer.h"
+#include "PageOverlay.h"
+#include "RenderCache.h"
 #include <QPdfDocument>
 #include <QPrinter>
 #include <QPainter>
 #include <QMessageBox>
 #include <QPrinterInfo>
 #include <QPageSize>
+#include <QFileInfo>
 #include <QDebug>
 #include <algorithm>
 
-bool PdfPrinter::printFile(const QString &filePath, const QString &printerName, bool manualDuplex)
+static const int PrintResolution = 300;
+
+int PdfPrinter::renderResolution(const QString &printerName)
+{
+    QPrinter printer(QPrinter::HighResolution);
+    printer.setPrinterName(printerName);
+    printer.setOutputFormat(QPrinter::NativeFormat);
+    printer.setResolution(PrintResolution);
+    return printer.resolution();
+}
+
+bool PdfPrinter::printFile(const QString &filePath, const QString &printerName, bool manualDuplex,
+                           const PdfPreflight::Info &preflight, SpeculativeRenderer *speculative,
+                           const QList<QSizeF> &workerPageSizes)
 {
     qDebug() << "Starting print job for:" << filePath;
 
+    // With the worker pool the document is never opened in this process, so a
+    // file that crashes or hangs the PDF engine only takes down a worker.
+    RenderWorkerPool *pool = RenderWorkerPool::instance();
+
+    // Workers keep the file open while the document is loaded; every return
+    // path has to let go of it before FileWatcher deletes the file.
+    struct PoolRelease {
+        RenderWorkerPool *pool;
+        ~PoolRelease() { if (pool) pool->releaseDocuments(); }
+    } poolRelease{pool};
+
     QPdfDocument pdf;
-    auto loadResult = pdf.load(filePath);
-    if (loadResult != QPdfDocument::Error::None) {
-        qDebug() << "Failed to load PDF. Error code:" << static_cast<int>(loadResult);
-        QMessageBox::warning(nullptr, "Error", "Failed to load PDF: " + filePath);
-        return false;
+    QList<QSizeF> pageSizes;
+    if (pool && preflight.valid) {
+        for (const PdfPreflight::Page &page : preflight.pages)
+            pageSizes.append(page.pointSize());
+    } else if (pool && !workerPageSizes.isEmpty()) {
+        pageSizes = workerPageSizes;
+    } else if (pool) {
+        if (!pool->pageSizes(filePath, &pageSizes)) {
+            qDebug() << "Render worker failed to load PDF:" << filePath;
+            QMessageBox::warning(nullptr, "Error", "Failed to load PDF: " + filePath);
+            return false;
+        }
+    } else {
+        auto loadResult = pdf.load(filePath);
+        if (loadResult != QPdfDocument::Error::None) {
+            qDebug() << "Failed to load PDF. Error code:" << static_cast<int>(loadResult);
+            QMessageBox::warning(nullptr, "Error", "Failed to load PDF: " + filePath);
+            return false;
+        }
+        for (int i = 0; i < pdf.pageCount(); ++i)
+            pageSizes.append(pdf.pagePointSize(i));
     }
 
-    int totalPages = pdf.pageCount();
+    int totalPages = pageSizes.size();
     qDebug() << "PDF loaded successfully. Pages:" << totalPages;
 
+    const bool usePreflight = preflight.valid && preflight.pageCount() == totalPages;
+    if (preflight.valid && !usePreflight)
+        qDebug() << "Preflight found" << preflight.pageCount() << "pages, ignoring it for page sizes.";
+
     QPrinter printer(QPrinter::HighResolution);
     printer.setPrinterName(printerName);
     if (!printer.isValid()) {
@@ -37,48 +86,131 @@ bool PdfPrinter::printFile(const QString &filePath, const QString &printerName,
 
     printer.setOutputFormat(QPrinter::NativeFormat);
     printer.setColorMode(QPrinter::Color);
-    printer.setResolution(300);
-    QSizeF pdfPageSizeMM = pdf.pagePointSize(0) * 0.352778;
-    printer.setPageSize(QPageSize(pdfPageSizeMM, QPageSize::Millimeter));
-    printer.setPageOrientation(QPageLayout::Portrait);
+    printer.setResolution(PrintResolution);
     printer.setFullPage(true);
 
+    // Page layout changes take effect on the next begin() or newPage(), so
+    // this is called right before each of those for mixed-size documents.
+    auto applyPageSize = [&](int pageIndex) {
+        if (pageIndex >= totalPages)
+            return;
+        QSizeF pointSize = usePreflight ? preflight.pages.at(pageIndex).pointSize()
+                                        : pageSizes.at(pageIndex);
+        bool landscape = pointSize.width() > pointSize.height();
+        if (landscape)
+            pointSize.transpose();
+        printer.setPageSize(QPageSize(pointSize * 0.352778, QPageSize::Millimeter));
+        printer.setPageOrientation(landscape ? QPageLayout::Landscape : QPageLayout::Portrait);
+    };
+
+    applyPageSize(0);
+
     QPainter painter;
     if (!painter.begin(&printer)) {
         QMessageBox::warning(nullptr, "Error", "Failed to begin printing.");
         return false;
     }
 
+    PageOverlay overlay(QFileInfo(filePath).fileName(), totalPages);
+
+    RenderCache *cache = RenderCache::instance();
+    const QByteArray contentHash = cache ? RenderCache::contentHash(filePath) : QByteArray();
+    const RenderCache::Statistics statsBefore = cache ? cache->statistics() : RenderCache::Statistics();
+
+    auto renderSizeFor = [&](int pageIndex) -> QSize {
+        QSizeF pdfPageSize = pageSizes.at(pageIndex);
+        int dpi = printer.resolution();
+        return QSize(pdfPageSize.width() * dpi / 72.0, pdfPageSize.height() * dpi / 72.0);
+    };
+
+    auto cacheKeyFor = [&](int pageIndex) -> RenderCache::Key {
+        RenderCache::Key key;
+        key.contentHash = contentHash;
+        key.pageIndex = pageIndex;
+        key.dpi = printer.resolution();
+        key.colorMode = printer.colorMode();
+        return key;
+    };
+
+    // A document the preflight could parse may still be rejected by the PDF
+    // engine in the workers; the job is then aborted rather than printed blank.
+    bool documentFailed = false;
+    int renderedPages = 0;
+
     auto printPages = [&](const QList<int> &pages) -> bool {
+        // Pages are resolved a little ahead of printing: loaded from the cache
+        // if it has them, otherwise submitted to the pool. Every request made
+        // is taken in submission order, so none can hold up the pool's queue.
+        QHash<int, QImage> cachedImages;
+        QHash<int, quint32> requests;
+        const int lookahead = pool ? 2 * pool->workerCount() : 1;
+        int resolved = 0;
+        auto resolveUpTo = [&](int end) {
+            for (; resolved < qMin(end, int(pages.size())); ++resolved) {
+                const int pageIndex = pages.at(resolved);
+                QImage image = cache ? cache->load(cacheKeyFor(pageIndex)) : QImage();
+                if (!image.isNull() && image.size() == renderSizeFor(pageIndex))
+                    cachedImages.insert(resolved, image);
+                else if (pool)
+                    requests.insert(resolved, pool->submit(filePath, pageIndex, renderSizeFor(pageIndex)));
+            }
+        };
+
         bool firstPage = true;
-        for (int pageIndex : pages) {
-            if (!firstPage && !printer.newPage()) {
-                qDebug() << "Failed to create new page";
-                return false;
+        for (int i = 0; i < pages.size(); ++i) {
+            int pageIndex = pages.at(i);
+            resolveUpTo(i + lookahead);
+            if (!firstPage) {
+                applyPageSize(pageIndex);
+                if (!printer.newPage()) {
+                    qDebug() << "Failed to create new page";
+                    if (pool)
+                        pool->cancelAll();
+                    return false;
+                }
             }
             firstPage = false;
 
             QRect pageRect = printer.pageRect(QPrinter::DevicePixel).toRect();
-            QSizeF pdfPageSize = pdf.pagePointSize(pageIndex);
-            int dpi = printer.resolution();
-            QSize renderSize(pdfPageSize.width() * dpi / 72.0, pdfPageSize.height() * dpi / 72.0);
 
-            QImage image = pdf.render(pageIndex, renderSize);
+            const QSize renderSize = renderSizeFor(pageIndex);
+            QImage image = cachedImages.take(i);
+
+            if (image.isNull()) {
+                if (pool) {
+                    image = pool->take(requests.take(i), &documentFailed);
+                    if (documentFailed) {
+                        qDebug() << "Render worker failed to load PDF:" << filePath;
+                        pool->cancelAll();
+                        printer.abort();
+                        return false;
+                    }
+                } else if (speculative) {
+                    image = speculative->takePage(pageIndex, renderSize);
+                }
+                if (image.isNull() && !pool)
+                    image = pdf.render(pageIndex, renderSize);
+                if (cache && !image.isNull())
+                    cache->store(cacheKeyFor(pageIndex), image);
+            }
+
             if (image.isNull()) {
                 qDebug() << "Failed to render page" << (pageIndex + 1);
                 continue;
             }
 
             painter.drawImage(pageRect, image);
-
-            QPen pen(QColor(250, 250, 250));
-            pen.setWidth(1);
-            painter.setPen(pen);
-            painter.drawLine(pageRect.topLeft(), pageRect.bottomRight());
+            overlay.paint(painter, pageRect, pageIndex);
+            ++renderedPages;
         }
         return true;
     };
 
+    auto reportDocumentFailed = [&]() {
+        painter.end();
+        QMessageBox::warning(nullptr, "Error", "Failed to load PDF: " + filePath);
+    };
+
     bool success = true;
 
     if (manualDuplex && totalPages > 1) {
@@ -92,6 +224,10 @@ bool PdfPrinter::printFile(const QString &filePath, const QString &printerName,
 
         qDebug() << "Printing odd pages...";
         if (!printPages(oddPages)) success = false;
+        if (documentFailed) {
+            reportDocumentFailed();
+            return false;
+        }
         painter.end();
 
         QMessageBox msgBox;
@@ -106,32 +242,24 @@ bool PdfPrinter::printFile(const QString &filePath, const QString &printerName,
         msgBox.setStandardButtons(QMessageBox::Ok | QMessageBox::Cancel);
 
         if (msgBox.exec() == QMessageBox::Ok) {
+            bool hasOddPageCount = (totalPages % 2 != 0);
+            std::reverse(evenPages.begin(), evenPages.end());
+
+            applyPageSize(hasOddPageCount ? totalPages - 1 : evenPages.first());
             if (!painter.begin(&printer)) {
                 QMessageBox::warning(nullptr, "Error", "Failed to begin printing even pages.");
                 return false;
             }
 
-            bool hasOddPageCount = (totalPages % 2 != 0);
-            std::reverse(evenPages.begin(), evenPages.end());
             qDebug() << "Printing even pages in reverse" << (hasOddPageCount ? "with blank page first" : "");
 
             if (hasOddPageCount) {
                 qDebug() << "Document has odd page count — printing a forced blank page first.";
                 QRect pageRect = printer.pageRect(QPrinter::DevicePixel).toRect();
-
-                QImage blankImage(pageRect.size(), QImage::Format_RGB32);
-                blankImage.fill(Qt::white);
-
-                QPainter imgPainter(&blankImage);
-                QPen pen(QColor(250, 250, 250));
-                pen.setWidth(1);
-                imgPainter.setPen(pen);
-                imgPainter.drawLine(0, 0, pageRect.width(), pageRect.height());
-                imgPainter.end();
-
-                painter.drawImage(pageRect, blankImage);
+                overlay.paintBlank(painter, pageRect);
                 painter.end();
 
+                applyPageSize(evenPages.first());
                 if (!painter.begin(&printer)) {
                     qDebug() << "Failed to restart painter after blank page.";
                     success = false;
@@ -140,32 +268,10 @@ bool PdfPrinter::printFile(const QString &filePath, const QString &printerName,
                 }
             }
 
-            bool firstPage = true;
-            for (int pageIndex : evenPages) {
-                if (!firstPage && !printer.newPage()) {
-                    qDebug() << "Failed to create new page for even side.";
-                    success = false;
-                    break;
-                }
-                firstPage = false;
-
-                QRect pageRect = printer.pageRect(QPrinter::DevicePixel).toRect();
-                QSizeF pdfPageSize = pdf.pagePointSize(pageIndex);
-                int dpi = printer.resolution();
-                QSize renderSize(pdfPageSize.width() * dpi / 72.0, pdfPageSize.height() * dpi / 72.0);
-
-                QImage image = pdf.render(pageIndex, renderSize);
-                if (image.isNull()) {
-                    qDebug() << "Failed to render even page" << (pageIndex + 1);
-                    continue;
-                }
-
-                painter.drawImage(pageRect, image);
-
-                QPen pen(QColor(250, 250, 250));
-                pen.setWidth(1);
-                painter.setPen(pen);
-                painter.drawLine(pageRect.topLeft(), pageRect.bottomRight());
+            if (!printPages(evenPages)) success = false;
+            if (documentFailed) {
+                reportDocumentFailed();
+                return false;
             }
         }
 
@@ -173,11 +279,30 @@ bool PdfPrinter::printFile(const QString &filePath, const QString &printerName,
         QList<int> allPages;
         for (int i = 0; i < totalPages; ++i) allPages.append(i);
         if (!printPages(allPages)) success = false;
+        if (documentFailed) {
+            reportDocumentFailed();
+            return false;
+        }
+    }
+
+    // Nothing but blank sheets; drop the job and keep the file for a retry.
+    if (totalPages > 0 && renderedPages == 0) {
+        qDebug() << "No page of" << filePath << "could be rendered";
+        printer.abort();
+        success = false;
     }
 
     painter.end();
     pdf.close();
 
+    if (cache) {
+        // Stores finish in the background, so only hits and misses are per job.
+        RenderCache::Statistics stats = cache->statistics();
+        qDebug() << "Render cache this job - hits:" << stats.hits - statsBefore.hits
+                 << "misses:" << stats.misses - statsBefore.misses
+                 << "| since start - stored:" << stats.stores << "evicted:" << stats.evictions;
+    }
+
     if (success) {
         QMessageBox::information(nullptr, "Print Complete",
                                  QString("Document printed successfully!\n%1 pages sent to %2")
@@ -2,11 +2,20 @@
 #define PDFPRINTER_H
 
 #include <QString>
+#include <QList>
+#include <QSizeF>
+#include "PdfPreflight.h"
+
+class SpeculativeRenderer;
 
 class PdfPrinter
 {
 public:
-    static bool printFile(const QString &filePath, const QString &printerName, bool manualDuplex);
+    static bool printFile(const QString &filePath, const QString &printerName, bool manualDuplex,
+                          const PdfPreflight::Info &preflight = PdfPreflight::Info(),
+                          SpeculativeRenderer *speculative = nullptr,
+                          const QList<QSizeF> &workerPageSizes = QList<QSizeF>());
+    static int renderResolution(const QString &printerName);
 };
 
 #endif
@@ -7,6 +7,10 @@
 #include <QLabel>
 #include <QVBoxLayout>
 #include <QHBoxLayout>
+#include <QScrollArea>
+#include <QPixmap>
+#include <QImage>
+#include <QList>
 
 class PrinterSelectionDialog : public QDialog
 {
@@ -19,6 +23,11 @@ public:
         Normal
     };
 
+    enum {
+        ThumbnailHeight = 140,
+        MaxThumbnails = 12
+    };
+
     explicit PrinterSelectionDialog(const QString &filename, const QStringList &printers, QWidget *parent = nullptr)
         : QDialog(parent), selectedMode(None)
     {
@@ -34,6 +43,16 @@ public:
         fileLabel->setWordWrap(true);
         mainLayout->addWidget(fileLabel);
 
+        previewArea = new QScrollArea(this);
+        previewArea->setFixedHeight(ThumbnailHeight + 30);
+        previewArea->setWidgetResizable(true);
+        previewArea->setVisible(false);
+        QWidget *previewStrip = new QWidget(previewArea);
+        previewLayout = new QHBoxLayout(previewStrip);
+        previewLayout->setAlignment(Qt::AlignLeft);
+        previewArea->setWidget(previewStrip);
+        mainLayout->addWidget(previewArea);
+
         mainLayout->addSpacing(10);
 
         QLabel *printerLabel = new QLabel("Select Printer:", this);
@@ -43,6 +62,8 @@ public:
         printerCombo->addItems(printers);
         mainLayout->addWidget(printerCombo);
 
+        connect(printerCombo, &QComboBox::currentTextChanged, this, &PrinterSelectionDialog::printerChanged);
+
         mainLayout->addSpacing(10);
 
         QLabel *modeLabel = new QLabel("Choose print mode:", this);
@@ -84,8 +105,41 @@ public:
         return selectedMode;
     }
 
+signals:
+    void printerChanged(const QString &printerName);
+
+public slots:
+    void setPageCount(int pageCount) {
+        if (!thumbnails.isEmpty() || pageCount <= 0)
+            return;
+
+        for (int i = 0; i < qMin(pageCount, int(MaxThumbnails)); ++i) {
+            QLabel *thumbnail = new QLabel(QString::number(i + 1), previewArea->widget());
+            thumbnail->setAlignment(Qt::AlignCenter);
+            thumbnail->setFrameShape(QFrame::Box);
+            thumbnail->setFixedSize(ThumbnailHeight * 70 / 99, ThumbnailHeight);
+            previewLayout->addWidget(thumbnail);
+            thumbnails.append(thumbnail);
+        }
+        if (pageCount > MaxThumbnails)
+            previewLayout->addWidget(new QLabel(QString("+%1 more").arg(pageCount - MaxThumbnails),
+                                                previewArea->widget()));
+
+        previewArea->setVisible(true);
+    }
+
+    void setThumbnail(int pageIndex, const QImage &image) {
+        if (pageIndex < 0 || pageIndex >= thumbnails.size() || image.isNull())
+            return;
+        thumbnails[pageIndex]->setPixmap(QPixmap::fromImage(image));
+        thumbnails[pageIndex]->setFixedSize(image.size());
+    }
+
 private:
     QComboBox *printerCombo;
+    QScrollArea *previewArea;
+    QHBoxLayout *previewLayout;
+    QList<QLabel *> thumbnails;
     PrintMode selectedMode;
 };
 
@@ -0,0 +1,270 @@
+#include "RenderCache.h"
+#include "Config.h"
+#include <QFile>
+#include <QSaveFile>
+#include <QDir>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QCryptographicHash>
+#include <QStandardPaths>
+#include <QThread>
+#include <QMutexLocker>
+#include <QDebug>
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+const char CacheMagic[4] = { 'Q', 'P', 'R', 'C' };
+const quint32 CacheVersion = 1;
+
+// Each queued raster holds a full page in memory until it is written.
+const int MaxPendingWrites = 4;
+
+struct CacheHeader
+{
+    char magic[4];
+    quint32 version;
+    qint32 width;
+    qint32 height;
+    qint32 format;
+    qint32 bytesPerLine;
+};
+
+}
+
+RenderCache *RenderCache::instance()
+{
+    static RenderCache cache;
+    return cache.maxBytes > 0 ? &cache : nullptr;
+}
+
+RenderCache::RenderCache()
+    : maxBytes(qint64(Config::getRenderCacheSize()) * 1024 * 1024)
+    , totalBytes(0)
+    , indexLoaded(false)
+    , writer(nullptr)
+    , stopping(false)
+{
+    directory = QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/render";
+}
+
+RenderCache::~RenderCache()
+{
+    {
+        QMutexLocker locker(&mutex);
+        stopping = true;
+    }
+    queued.wakeAll();
+
+    // The writer drains the queue before it exits.
+    if (writer) {
+        writer->wait();
+        delete writer;
+    }
+}
+
+RenderCache::Statistics RenderCache::statistics() const
+{
+    QMutexLocker locker(&mutex);
+    return stats;
+}
+
+QByteArray RenderCache::contentHash(const QString &filePath)
+{
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly))
+        return QByteArray();
+
+    QCryptographicHash hash(QCryptographicHash::Sha256);
+    if (!hash.addData(&file))
+        return QByteArray();
+    return hash.result();
+}
+
+QString RenderCache::fileName(const Key &key) const
+{
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(key.contentHash);
+    hash.addData(QByteArray::number(key.pageIndex) + '/' + QByteArray::number(key.dpi)
+                 + '/' + QByteArray::number(key.colorMode));
+    return QString::fromLatin1(hash.result().toHex()) + ".qpr";
+}
+
+void RenderCache::loadIndex()
+{
+    if (indexLoaded)
+        return;
+    indexLoaded = true;
+
+    QDir dir(directory);
+    if (!dir.exists())
+        dir.mkpath(".");
+
+    const QFileInfoList files = dir.entryInfoList(QStringList() << "*.qpr", QDir::Files);
+    for (const QFileInfo &info : files) {
+        Entry entry;
+        entry.size = info.size();
+        entry.lastUsed = info.lastModified().toMSecsSinceEpoch();
+        entries.insert(info.fileName(), entry);
+        totalBytes += entry.size;
+    }
+
+    qDebug() << "Render cache:" << entries.size() << "entries," << totalBytes / (1024 * 1024) << "MB in" << directory;
+}
+
+QImage RenderCache::load(const Key &key)
+{
+    // Held throughout so the writer cannot evict the file while it is mapped.
+    QMutexLocker locker(&mutex);
+    loadIndex();
+
+    const QString name = fileName(key);
+    if (key.contentHash.isEmpty() || !entries.contains(name)) {
+        stats.misses++;
+        return QImage();
+    }
+
+    QFile file(directory + "/" + name);
+    uchar *mapped = nullptr;
+    if (file.open(QIODevice::ReadOnly) && file.size() > qint64(sizeof(CacheHeader)))
+        mapped = file.map(0, file.size());
+
+    QImage image;
+    if (mapped) {
+        CacheHeader header;
+        std::memcpy(&header, mapped, sizeof(header));
+        if (std::memcmp(header.magic, CacheMagic, sizeof(CacheMagic)) == 0 && header.version == CacheVersion) {
+            // The decompressed buffer becomes the image's storage.
+            auto *pixels = new QByteArray(qUncompress(mapped + sizeof(header), int(file.size() - sizeof(header))));
+            if (pixels->size() == qsizetype(header.bytesPerLine) * header.height) {
+                image = QImage(reinterpret_cast<uchar *>(pixels->data()), header.width, header.height,
+                               header.bytesPerLine, QImage::Format(header.format),
+                               [](void *info) { delete static_cast<QByteArray *>(info); }, pixels);
+            } else {
+                delete pixels;
+            }
+        }
+        file.unmap(mapped);
+    }
+    file.close();
+
+    if (image.isNull()) {
+        qDebug() << "Dropping unreadable render cache entry:" << name;
+        totalBytes -= entries.take(name).size;
+        QFile::remove(directory + "/" + name);
+        stats.misses++;
+        return QImage();
+    }
+
+    // The file time carries the LRU order across restarts.
+    const QDateTime now = QDateTime::currentDateTime();
+    entries[name].lastUsed = now.toMSecsSinceEpoch();
+    if (file.open(QIODevice::Append))
+        file.setFileTime(now, QFileDevice::FileModificationTime);
+
+    stats.hits++;
+    return image;
+}
+
+void RenderCache::store(const Key &key, const QImage &image)
+{
+    if (key.contentHash.isEmpty() || image.isNull())
+        return;
+
+    const QString name = fileName(key);
+    {
+        QMutexLocker locker(&mutex);
+        if (stopping || pending.size() >= MaxPendingWrites)
+            return;
+        pending.append(qMakePair(name, image));
+    }
+    queued.wakeAll();
+
+    if (!writer) {
+        writer = QThread::create([this]() { writeEntries(); });
+        writer->start(QThread::LowPriority);
+    }
+}
+
+void RenderCache::writeEntries()
+{
+    QMutexLocker locker(&mutex);
+    forever {
+        while (pending.isEmpty() && !stopping)
+            queued.wait(&mutex);
+        if (pending.isEmpty())
+            return;
+
+        const QPair<QString, QImage> next = pending.takeFirst();
+        locker.unlock();
+        write(next.first, next.second);
+        locker.relock();
+    }
+}
+
+void RenderCache::write(const QString &name, const QImage &image)
+{
+    CacheHeader header;
+    std::memcpy(header.magic, CacheMagic, sizeof(CacheMagic));
+    header.version = CacheVersion;
+    header.width = image.width();
+    header.height = image.height();
+    header.format = image.format();
+    header.bytesPerLine = int(image.bytesPerLine());
+
+    // Page rasters are mostly white, so the fastest level already compresses well.
+    const QByteArray compressed = qCompress(image.constBits(), int(image.sizeInBytes()), 1);
+    if (compressed.isEmpty())
+        return;
+
+    {
+        QMutexLocker locker(&mutex);
+        loadIndex();
+    }
+
+    // Written under a temporary name so a reader never maps a partial entry.
+    QSaveFile file(directory + "/" + name);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qDebug() << "Failed to write render cache entry:" << file.errorString();
+        return;
+    }
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(compressed);
+    if (!file.commit()) {
+        qDebug() << "Failed to write render cache entry:" << file.errorString();
+        return;
+    }
+
+    QMutexLocker locker(&mutex);
+    if (entries.contains(name))
+        totalBytes -= entries.value(name).size;
+
+    Entry entry;
+    entry.size = qint64(sizeof(header)) + compressed.size();
+    entry.lastUsed = QDateTime::currentMSecsSinceEpoch();
+    entries.insert(name, entry);
+    totalBytes += entry.size;
+    stats.stores++;
+
+    if (totalBytes > maxBytes)
+        evict();
+}
+
+void RenderCache::evict()
+{
+    QList<QPair<qint64, QString>> byAge;
+    for (auto it = entries.constBegin(); it != entries.constEnd(); ++it)
+        byAge.append(qMakePair(it.value().lastUsed, it.key()));
+    std::sort(byAge.begin(), byAge.end());
+
+    // Trim below the limit so every store does not trigger another sweep.
+    const qint64 target = maxBytes * 9 / 10;
+    for (const auto &candidate : byAge) {
+        if (totalBytes <= target)
+            break;
+        QFile::remove(directory + "/" + candidate.second);
+        totalBytes -= entries.take(candidate.second).size;
+        stats.evictions++;
+    }
+}
@@ -0,0 +1,76 @@
+#ifndef RENDERCACHE_H
+#define RENDERCACHE_H
+
+#include <QString>
+#include <QByteArray>
+#include <QHash>
+#include <QImage>
+#include <QList>
+#include <QPair>
+#include <QMutex>
+#include <QWaitCondition>
+
+class QThread;
+
+// Bounded on-disk cache of rendered page rasters, so reprinting the same
+// document does not rasterize it again. Entries are zlib-compressed, read
+// through a memory mapping and evicted least-recently-used first. Stores are
+// compressed and written on a background thread, off the print path.
+class RenderCache
+{
+public:
+    struct Key {
+        QByteArray contentHash;
+        int pageIndex = 0;
+        int dpi = 0;
+        int colorMode = 0;
+    };
+
+    struct Statistics {
+        qint64 hits = 0;
+        qint64 misses = 0;
+        qint64 stores = 0;
+        qint64 evictions = 0;
+    };
+
+    // Returns nullptr when RenderCacheSizeMB is 0.
+    static RenderCache *instance();
+    static QByteArray contentHash(const QString &filePath);
+
+    QImage load(const Key &key);
+    // Queues the raster for writing; dropped if the writer is too far behind.
+    void store(const Key &key, const QImage &image);
+
+    Statistics statistics() const;
+
+private:
+    struct Entry {
+        qint64 size = 0;
+        qint64 lastUsed = 0;
+    };
+
+    RenderCache();
+    ~RenderCache();
+
+    QString fileName(const Key &key) const;
+    void loadIndex();
+    void evict();
+    void writeEntries();
+    void write(const QString &name, const QImage &image);
+
+    QString directory;
+    qint64 maxBytes;
+    qint64 totalBytes;
+    bool indexLoaded;
+    QHash<QString, Entry> entries;
+    Statistics stats;
+
+    // Guards everything above once the writer thread is running.
+    mutable QMutex mutex;
+    QWaitCondition queued;
+    QList<QPair<QString, QImage>> pending;
+    QThread *writer;
+    bool stopping;
+};
+
+#endif
@@ -0,0 +1,613 @@
+#include "RenderWorkerPool.h"
+#include "Config.h"
+#include <QPdfDocument>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QProcess>
+#include <QSharedMemory>
+#include <QDataStream>
+#include <QCoreApplication>
+#include <QPointer>
+#include <QDebug>
+#include <cstring>
+
+static const char *WorkerArgument = "--render-worker";
+static const int ConnectTimeoutMs = 5000;
+static const int PollSliceMs = 25;
+
+enum RenderStatus : quint8 {
+    Rendered,
+    RenderFailed,
+    LoadFailed
+};
+
+RenderWorkerPool *RenderWorkerPool::instance()
+{
+    static QPointer<RenderWorkerPool> pool;
+    static bool attempted = false;
+
+    if (!attempted) {
+        attempted = true;
+        int workerCount = Config::getRenderWorkerCount();
+        if (workerCount > 0) {
+            pool = new RenderWorkerPool(workerCount, Config::getRenderWorkerTimeout(), qApp);
+            if (pool->liveWorkerCount() == 0) {
+                qDebug() << "No render workers could be started, rendering in-process.";
+                delete pool;
+            }
+        }
+    }
+    return pool;
+}
+
+bool RenderWorkerPool::isWorkerProcess(const QStringList &arguments)
+{
+    return arguments.contains(WorkerArgument);
+}
+
+static bool loadDocument(QPdfDocument &pdf, QString &loadedPath, const QString &filePath)
+{
+    if (loadedPath != filePath) {
+        pdf.close();
+        loadedPath.clear();
+        if (pdf.load(filePath) != QPdfDocument::Error::None)
+            return false;
+        loadedPath = filePath;
+    }
+    return true;
+}
+
+static RenderStatus renderIntoSegment(QPdfDocument &pdf, QString &loadedPath, const QString &filePath,
+                                      int pageIndex, const QSize &size, const QString &key)
+{
+    if (!loadDocument(pdf, loadedPath, filePath))
+        return LoadFailed;
+
+    QImage image = pdf.render(pageIndex, size);
+    if (image.isNull() || image.size() != size)
+        return RenderFailed;
+    image = image.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+
+    QSharedMemory segment(key);
+    if (!segment.attach())
+        return RenderFailed;
+
+    const qsizetype lineBytes = qsizetype(size.width()) * 4;
+    bool ok = segment.size() >= lineBytes * size.height();
+    if (ok && segment.lock()) {
+        uchar *dst = static_cast<uchar *>(segment.data());
+        for (int y = 0; y < size.height(); ++y)
+            std::memcpy(dst + y * lineBytes, image.constScanLine(y), lineBytes);
+        segment.unlock();
+    } else {
+        ok = false;
+    }
+    segment.detach();
+    return ok ? Rendered : RenderFailed;
+}
+
+int RenderWorkerPool::runWorker(const QStringList &arguments)
+{
+    QString serverName = arguments.value(arguments.indexOf(WorkerArgument) + 1);
+
+    QLocalSocket socket;
+    socket.connectToServer(serverName);
+    if (!socket.waitForConnected(ConnectTimeoutMs))
+        return 1;
+
+    QDataStream stream(&socket);
+    stream.setVersion(QDataStream::Qt_5_15);
+    stream << qint64(QCoreApplication::applicationPid());
+    socket.waitForBytesWritten(ConnectTimeoutMs);
+
+    QPdfDocument pdf;
+    QString loadedPath;
+
+    while (socket.state() == QLocalSocket::ConnectedState) {
+        if (socket.bytesAvailable() == 0 && !socket.waitForReadyRead(-1))
+            break;
+
+        forever {
+            quint8 type;
+            quint32 id;
+            QString filePath;
+            qint32 pageIndex = 0;
+            QSize size;
+            QString key;
+
+            stream.startTransaction();
+            stream >> type >> id >> filePath;
+            if (type == RenderPage)
+                stream >> pageIndex >> size >> key;
+            if (!stream.commitTransaction())
+                break;
+
+            if (type == RenderPage) {
+                RenderStatus status = renderIntoSegment(pdf, loadedPath, filePath, pageIndex, size, key);
+                stream << id << quint8(status);
+            } else if (type == DocumentInfo) {
+                QList<QSizeF> sizes;
+                bool ok = loadDocument(pdf, loadedPath, filePath);
+                for (int i = 0; ok && i < pdf.pageCount(); ++i)
+                    sizes.append(pdf.pagePointSize(i));
+                stream << id << ok << sizes;
+            } else if (type == ReleaseDocument) {
+                // QtPdf keeps the file open while loaded, which would stop the
+                // service from deleting it after printing.
+                pdf.close();
+                loadedPath.clear();
+                stream << id << true;
+            }
+            socket.waitForBytesWritten(ConnectTimeoutMs);
+        }
+    }
+
+    return 0;
+}
+
+RenderWorkerPool::RenderWorkerPool(int workerCount, int timeoutMs, QObject *parent)
+    : QObject(parent), timeoutMs(timeoutMs), nextRequestId(1)
+{
+    server = new QLocalServer(this);
+    QString serverName = QString("QuantumPrint_RenderPool_%1").arg(QCoreApplication::applicationPid());
+    QLocalServer::removeServer(serverName);
+    if (!server->listen(serverName)) {
+        qDebug() << "Render pool failed to listen:" << server->errorString();
+        return;
+    }
+
+    workers.resize(workerCount);
+    for (Worker &worker : workers)
+        startWorker(worker);
+
+    qDebug() << "Render worker pool started with" << liveWorkerCount() << "workers";
+}
+
+RenderWorkerPool::~RenderWorkerPool()
+{
+    for (Worker &worker : workers)
+        stopWorker(worker);
+}
+
+bool RenderWorkerPool::startWorker(Worker &worker)
+{
+    worker.process = new QProcess(this);
+    worker.process->setProcessChannelMode(QProcess::ForwardedChannels);
+    worker.process->start(QCoreApplication::applicationFilePath(),
+                          QStringList() << WorkerArgument << server->serverName());
+    if (!worker.process->waitForStarted(ConnectTimeoutMs)) {
+        qDebug() << "Failed to start render worker:" << worker.process->errorString();
+        stopWorker(worker);
+        return false;
+    }
+
+    const qint64 pid = worker.process->processId();
+    QElapsedTimer waited;
+    waited.start();
+
+    // A worker killed during a restart may still have a connection queued;
+    // only accept the one announcing the pid we just launched.
+    while (!worker.socket && waited.elapsed() < ConnectTimeoutMs) {
+        if (!server->hasPendingConnections()
+            && !server->waitForNewConnection(int(ConnectTimeoutMs - waited.elapsed())))
+            break;
+
+        QLocalSocket *socket = server->nextPendingConnection();
+        if (!socket)
+            continue;
+
+        QDataStream stream(socket);
+        stream.setVersion(QDataStream::Qt_5_15);
+        qint64 hello = 0;
+        forever {
+            stream.startTransaction();
+            stream >> hello;
+            if (stream.commitTransaction())
+                break;
+            if (!socket->waitForReadyRead(int(ConnectTimeoutMs - waited.elapsed())))
+                break;
+        }
+
+        if (hello == pid) {
+            worker.socket = socket;
+            socket->setParent(this);
+        } else {
+            delete socket;
+        }
+    }
+
+    if (!worker.socket) {
+        qDebug() << "Render worker did not connect, pid:" << pid;
+        stopWorker(worker);
+        return false;
+    }
+    return true;
+}
+
+void RenderWorkerPool::stopWorker(Worker &worker)
+{
+    if (worker.socket) {
+        worker.socket->disconnectFromServer();
+        delete worker.socket;
+        worker.socket = nullptr;
+    }
+    if (worker.process) {
+        // A busy worker is inside the PDF engine and will not notice the
+        // disconnect, so there is no point waiting for it to exit.
+        if (worker.busy)
+            worker.process->kill();
+        if (worker.process->state() != QProcess::NotRunning
+            && !worker.process->waitForFinished(1000)) {
+            worker.process->kill();
+            worker.process->waitForFinished(1000);
+        }
+        delete worker.process;
+        worker.process = nullptr;
+    }
+    delete worker.segment;
+    worker.segment = nullptr;
+    worker.busy = false;
+}
+
+int RenderWorkerPool::liveWorkerCount() const
+{
+    int count = 0;
+    for (const Worker &worker : workers) {
+        if (worker.socket)
+            ++count;
+    }
+    return count;
+}
+
+quint32 RenderWorkerPool::submit(const QString &filePath, int pageIndex, const QSize &size)
+{
+    Request request;
+    request.id = nextRequestId++;
+    request.filePath = filePath;
+    request.pageIndex = pageIndex;
+    request.size = size;
+    queue.append(request);
+
+    dispatch();
+    return request.id;
+}
+
+QImage RenderWorkerPool::take(quint32 requestId, bool *documentFailed)
+{
+    while (!results.contains(requestId) && isPending(requestId)) {
+        dispatch();
+        poll(PollSliceMs);
+    }
+    const bool failedLoad = failedLoads.remove(requestId);
+    if (documentFailed)
+        *documentFailed = failedLoad;
+    return results.take(requestId);
+}
+
+QImage RenderWorkerPool::takeIfReady(quint32 requestId, bool *ready)
+{
+    dispatch();
+    poll(0);
+    *ready = results.contains(requestId) || !isPending(requestId);
+    if (*ready)
+        failedLoads.remove(requestId);
+    return *ready ? results.take(requestId) : QImage();
+}
+
+void RenderWorkerPool::cancelAll()
+{
+    queue.clear();
+    results.clear();
+    pageSizeResults.clear();
+    failedLoads.clear();
+    for (const Worker &worker : workers) {
+        if (worker.busy)
+            discarded.insert(worker.request.id);
+    }
+}
+
+bool RenderWorkerPool::pageSizes(const QString &filePath, QList<QSizeF> *sizes)
+{
+    return takePageSizes(submitPageSizes(filePath), sizes);
+}
+
+quint32 RenderWorkerPool::submitPageSizes(const QString &filePath)
+{
+    Request request;
+    request.id = nextRequestId++;
+    request.type = DocumentInfo;
+    request.filePath = filePath;
+    queue.append(request);
+
+    dispatch();
+    return request.id;
+}
+
+bool RenderWorkerPool::takePageSizes(quint32 requestId, QList<QSizeF> *sizes)
+{
+    while (!pageSizeResults.contains(requestId) && isPending(requestId)) {
+        dispatch();
+        poll(PollSliceMs);
+    }
+    if (!pageSizeResults.contains(requestId))
+        return false;
+    *sizes = pageSizeResults.take(requestId);
+    return true;
+}
+
+bool RenderWorkerPool::takePageSizesIfReady(quint32 requestId, bool *ready, QList<QSizeF> *sizes)
+{
+    dispatch();
+    poll(0);
+    *ready = pageSizeResults.contains(requestId) || !isPending(requestId);
+    if (!*ready || !pageSizeResults.contains(requestId))
+        return false;
+    *sizes = pageSizeResults.take(requestId);
+    return true;
+}
+
+void RenderWorkerPool::releaseDocuments()
+{
+    cancelAll();
+
+    // Discarded work is not waited for: a busy worker may be stuck on a
+    // malformed file for the whole timeout. Restarting it is bounded and
+    // releases its file handle as well.
+    poll(0);
+    QList<bool> restarted(workers.size(), false);
+    for (int i = 0; i < workers.size(); ++i) {
+        Worker &worker = workers[i];
+        if (!worker.busy)
+            continue;
+        discarded.remove(worker.request.id);
+        stopWorker(worker);
+        startWorker(worker);
+        restarted[i] = true;
+    }
+
+    for (int i = 0; i < workers.size(); ++i) {
+        Worker &worker = workers[i];
+        if (!worker.socket || restarted[i])
+            continue;
+        QDataStream stream(worker.socket);
+        stream.setVersion(QDataStream::Qt_5_15);
+        stream << quint8(ReleaseDocument) << nextRequestId++ << QString();
+        worker.socket->flush();
+    }
+
+    for (int i = 0; i < workers.size(); ++i) {
+        Worker &worker = workers[i];
+        if (!worker.socket || restarted[i])
+            continue;
+
+        QDataStream stream(worker.socket);
+        stream.setVersion(QDataStream::Qt_5_15);
+        QElapsedTimer elapsed;
+        elapsed.start();
+        bool released = false;
+        forever {
+            quint32 id;
+            bool ok;
+            stream.startTransaction();
+            stream >> id >> ok;
+            if (stream.commitTransaction()) {
+                released = true;
+                break;
+            }
+            if (elapsed.elapsed() > ConnectTimeoutMs
+                || worker.socket->state() != QLocalSocket::ConnectedState)
+                break;
+            worker.socket->waitForReadyRead(PollSliceMs);
+        }
+
+        // A worker that does not answer still holds the file; restarting it
+        // releases the handle as well.
+        if (!released) {
+            qDebug() << "Render worker did not release its document - restarting worker";
+            stopWorker(worker);
+            startWorker(worker);
+        }
+    }
+}
+
+bool RenderWorkerPool::isPending(quint32 requestId) const
+{
+    for (const Request &request : queue) {
+        if (request.id == requestId)
+            return true;
+    }
+    for (const Worker &worker : workers) {
+        if (worker.busy && worker.request.id == requestId)
+            return true;
+    }
+    return false;
+}
+
+void RenderWorkerPool::dispatch()
+{
+    if (liveWorkerCount() == 0) {
+        for (const Request &request : queue) {
+            qDebug() << "No render worker available for page" << (request.pageIndex + 1);
+            recordFailure(request);
+        }
+        queue.clear();
+        return;
+    }
+
+    // Keep at most two rasters per worker outstanding so a slow printer does
+    // not let the pool render the whole document into memory ahead of it.
+    int outstanding = results.size();
+    for (const Worker &worker : workers) {
+        if (worker.busy)
+            ++outstanding;
+    }
+
+    for (Worker &worker : workers) {
+        if (queue.isEmpty() || outstanding >= 2 * workers.size())
+            break;
+        if (!worker.socket || worker.busy)
+            continue;
+
+        Request request = queue.takeFirst();
+        if (dispatchTo(worker, request))
+            ++outstanding;
+        else
+            recordFailure(request);
+    }
+}
+
+bool RenderWorkerPool::dispatchTo(Worker &worker, const Request &request)
+{
+    QDataStream stream(worker.socket);
+    stream.setVersion(QDataStream::Qt_5_15);
+
+    if (request.type == DocumentInfo) {
+        stream << quint8(DocumentInfo) << request.id << request.filePath;
+        worker.socket->flush();
+        worker.request = request;
+        worker.busy = true;
+        worker.elapsed.start();
+        return true;
+    }
+
+    QString key = QString("QuantumPrint_Render_%1_%2")
+                      .arg(QCoreApplication::applicationPid())
+                      .arg(request.id);
+    auto *segment = new QSharedMemory(key);
+    if (!segment->create(qsizetype(request.size.width()) * 4 * request.size.height())) {
+        qDebug() << "Failed to create render segment:" << segment->errorString();
+        delete segment;
+        return false;
+    }
+
+    stream << quint8(RenderPage) << request.id << request.filePath
+           << qint32(request.pageIndex) << request.size << key;
+    worker.socket->flush();
+
+    worker.segment = segment;
+    worker.request = request;
+    worker.busy = true;
+    worker.elapsed.start();
+    return true;
+}
+
+void RenderWorkerPool::poll(int waitMs)
+{
+    Worker *oldest = nullptr;
+    bool progressed = false;
+
+    for (Worker &worker : workers) {
+        if (!worker.busy)
+            continue;
+
+        // No event loop runs here, so every socket has to be pumped for a
+        // reply before it can be judged as exited or timed out.
+        if (worker.socket->bytesAvailable() == 0)
+            worker.socket->waitForReadyRead(0);
+        if (worker.socket->bytesAvailable() > 0)
+            readReply(worker);
+
+        if (!worker.busy) {
+            progressed = true;
+            continue;
+        }
+
+        if (worker.socket->state() != QLocalSocket::ConnectedState
+            || worker.process->state() != QProcess::Running) {
+            failRequest(worker, "worker exited", true);
+            progressed = true;
+        } else if (worker.elapsed.elapsed() > timeoutMs) {
+            failRequest(worker, "worker timed out", false);
+            progressed = true;
+        } else if (!oldest || worker.elapsed.elapsed() > oldest->elapsed.elapsed()) {
+            oldest = &worker;
+        }
+    }
+
+    if (!progressed && oldest && oldest->socket->waitForReadyRead(waitMs))
+        readReply(*oldest);
+}
+
+void RenderWorkerPool::readReply(Worker &worker)
+{
+    QDataStream stream(worker.socket);
+    stream.setVersion(QDataStream::Qt_5_15);
+
+    if (worker.request.type == DocumentInfo) {
+        quint32 id;
+        bool ok;
+        QList<QSizeF> sizes;
+        stream.startTransaction();
+        stream >> id >> ok >> sizes;
+        if (!stream.commitTransaction() || id != worker.request.id)
+            return;
+
+        worker.busy = false;
+        if (discarded.remove(id))
+            return;
+        if (ok)
+            pageSizeResults.insert(id, sizes);
+        else
+            qDebug() << "Render worker could not load" << worker.request.filePath;
+        return;
+    }
+
+    quint32 id;
+    quint8 status;
+    stream.startTransaction();
+    stream >> id >> status;
+    if (!stream.commitTransaction() || id != worker.request.id)
+        return;
+
+    QSharedMemory *segment = worker.segment;
+    worker.segment = nullptr;
+    worker.busy = false;
+
+    const bool wasDiscarded = discarded.remove(id);
+    if (wasDiscarded || status != Rendered) {
+        delete segment;
+        if (!wasDiscarded) {
+            qDebug() << "Render worker failed page" << (worker.request.pageIndex + 1)
+                     << (status == LoadFailed ? "- document could not be loaded" : "");
+            if (status == LoadFailed)
+                failedLoads.insert(id);
+            results.insert(id, QImage());
+        }
+        return;
+    }
+
+    // The image reads straight out of the segment; it is released together
+    // with the last copy of the image.
+    const QSize size = worker.request.size;
+    QImage image(static_cast<uchar *>(segment->data()), size.width(), size.height(),
+                 size.width() * 4, QImage::Format_ARGB32_Premultiplied,
+                 [](void *info) { delete static_cast<QSharedMemory *>(info); }, segment);
+    results.insert(id, image);
+}
+
+void RenderWorkerPool::failRequest(Worker &worker, const QString &reason, bool retry)
+{
+    Request request = worker.request;
+    qDebug() << "Render" << reason << "on page" << (request.pageIndex + 1) << "- restarting worker";
+
+    stopWorker(worker);
+    startWorker(worker);
+
+    if (discarded.remove(request.id))
+        return;
+
+    if (retry && request.attempts == 0) {
+        request.attempts++;
+        queue.prepend(request);
+    } else {
+        recordFailure(request);
+    }
+}
+
+// Page sizes are reported as missing from pageSizeResults, so only pages need
+// an entry to tell a failed request from a pending one.
+void RenderWorkerPool::recordFailure(const Request &request)
+{
+    if (request.type == RenderPage)
+        results.insert(request.id, QImage());
+}
@@ -0,0 +1,104 @@
+#ifndef RENDERWORKERPOOL_H
+#define RENDERWORKERPOOL_H
+
+#include <QObject>
+#include <QImage>
+#include <QHash>
+#include <QSet>
+#include <QList>
+#include <QSizeF>
+#include <QElapsedTimer>
+
+class QLocalServer;
+class QLocalSocket;
+class QProcess;
+class QSharedMemory;
+
+// Renders PDF pages in helper processes spawned from this executable, so a
+// malformed document can only take down a worker and not the tray service.
+// Rasters come back through shared memory segments owned by this process.
+class RenderWorkerPool : public QObject
+{
+    Q_OBJECT
+
+public:
+    // Returns nullptr when the pool is disabled (RenderWorkerCount = 0) or
+    // no worker could be started; callers then render in-process.
+    static RenderWorkerPool *instance();
+
+    static bool isWorkerProcess(const QStringList &arguments);
+    int workerCount() const { return workers.size(); }
+    static int runWorker(const QStringList &arguments);
+
+    // Page sizes in points as reported by a worker, for callers that must
+    // not open the document in this process. submitPageSizes() queues the
+    // request like a page; the take functions return false if it failed.
+    bool pageSizes(const QString &filePath, QList<QSizeF> *sizes);
+    quint32 submitPageSizes(const QString &filePath);
+    bool takePageSizes(quint32 requestId, QList<QSizeF> *sizes);
+    bool takePageSizesIfReady(quint32 requestId, bool *ready, QList<QSizeF> *sizes);
+
+    quint32 submit(const QString &filePath, int pageIndex, const QSize &size);
+    // Sets *documentFailed when the worker could not load the document at all,
+    // as opposed to failing this one page.
+    QImage take(quint32 requestId, bool *documentFailed = nullptr);
+    // Non-blocking take for callers driven by a timer; *ready stays false
+    // while the request is still queued or rendering.
+    QImage takeIfReady(quint32 requestId, bool *ready);
+    void cancelAll();
+
+    // Drops queued work and makes every worker close its document, so the
+    // file can be deleted. Call at the end of each job.
+    void releaseDocuments();
+
+private:
+    enum MessageType : quint8 {
+        RenderPage,
+        DocumentInfo,
+        ReleaseDocument
+    };
+
+    struct Request {
+        quint32 id = 0;
+        MessageType type = RenderPage;
+        QString filePath;
+        int pageIndex = 0;
+        QSize size;
+        int attempts = 0;
+    };
+
+    struct Worker {
+        QProcess *process = nullptr;
+        QLocalSocket *socket = nullptr;
+        QSharedMemory *segment = nullptr;
+        Request request;
+        bool busy = false;
+        QElapsedTimer elapsed;
+    };
+
+    RenderWorkerPool(int workerCount, int timeoutMs, QObject *parent);
+    ~RenderWorkerPool();
+
+    bool startWorker(Worker &worker);
+    void stopWorker(Worker &worker);
+    void dispatch();
+    bool dispatchTo(Worker &worker, const Request &request);
+    void poll(int waitMs);
+    void readReply(Worker &worker);
+    void failRequest(Worker &worker, const QString &reason, bool retry);
+    void recordFailure(const Request &request);
+    bool isPending(quint32 requestId) const;
+    int liveWorkerCount() const;
+
+    QLocalServer *server;
+    QList<Worker> workers;
+    QList<Request> queue;
+    QHash<quint32, QImage> results;
+    QHash<quint32, QList<QSizeF>> pageSizeResults;
+    QSet<quint32> failedLoads;
+    QSet<quint32> discarded;
+    int timeoutMs;
+    quint32 nextRequestId;
+};
+
+#endif
@@ -0,0 +1,236 @@
+#include "SpeculativeRenderer.h"
+#include "RenderWorkerPool.h"
+#include <QPdfDocument>
+#include <QMutexLocker>
+#include <QTimer>
+#include <QDebug>
+
+static const int SpeculativePageCount = 3;
+static const int CollectIntervalMs = 50;
+
+SpeculativeRenderer::SpeculativeRenderer(const QString &filePath, int thumbnailCount, int thumbnailHeight,
+                                         QObject *parent)
+    : QThread(parent)
+    , filePath(filePath)
+    , thumbnailCount(thumbnailCount)
+    , thumbnailHeight(thumbnailHeight)
+    , resolution(0)
+    , generation(0)
+    , pageLimit(-1)
+    , cancelled(false)
+    , printing(false)
+    , done(false)
+    , pool(nullptr)
+    , collectTimer(nullptr)
+    , pageSizeRequest(0)
+    , workerSizesKnown(false)
+{
+}
+
+SpeculativeRenderer::~SpeculativeRenderer()
+{
+    {
+        QMutexLocker locker(&mutex);
+        cancelled = true;
+    }
+    changed.wakeAll();
+    wait();
+}
+
+void SpeculativeRenderer::setResolution(int dpi)
+{
+    QMutexLocker locker(&mutex);
+    if (dpi == resolution)
+        return;
+
+    resolution = dpi;
+    ++generation;
+    pages.clear();
+    renderedPages.clear();
+    changed.wakeAll();
+}
+
+QImage SpeculativeRenderer::takePage(int pageIndex, const QSize &size)
+{
+    QMutexLocker locker(&mutex);
+    printing = true;
+    changed.wakeAll();
+
+    while (!cancelled && !done && resolution > 0
+           && (pageLimit < 0 || pageIndex < pageLimit)
+           && !renderedPages.contains(pageIndex))
+        changed.wait(&mutex);
+
+    QImage image = pages.take(pageIndex);
+    if (!image.isNull() && image.size() != size)
+        return QImage();
+    return image;
+}
+
+void SpeculativeRenderer::startWithPool(RenderWorkerPool *workerPool, const PdfPreflight::Info &preflight)
+{
+    {
+        QMutexLocker locker(&mutex);
+        done = true;
+    }
+
+    // Without a usable preflight the page sizes come from a worker as well;
+    // nothing here may block the dialog while a worker loads the file.
+    pool = workerPool;
+    if (preflight.valid) {
+        QList<QSizeF> sizes;
+        for (const PdfPreflight::Page &page : preflight.pages)
+            sizes.append(page.pointSize());
+        submitThumbnails(sizes);
+    } else {
+        pageSizeRequest = pool->submitPageSizes(filePath);
+    }
+
+    collectTimer = new QTimer(this);
+    connect(collectTimer, &QTimer::timeout, this, &SpeculativeRenderer::collectThumbnails);
+    collectTimer->start(CollectIntervalMs);
+}
+
+bool SpeculativeRenderer::workerPageSizes(QList<QSizeF> *sizes) const
+{
+    if (!workerSizesKnown)
+        return false;
+    *sizes = workerSizes;
+    return true;
+}
+
+void SpeculativeRenderer::submitThumbnails(const QList<QSizeF> &sizes)
+{
+    emit pageCountKnown(sizes.size());
+
+    for (int i = 0; i < qMin(int(sizes.size()), thumbnailCount); ++i) {
+        if (sizes[i].height() <= 0)
+            continue;
+        QSize size(sizes[i].width() * thumbnailHeight / sizes[i].height(), thumbnailHeight);
+        thumbnailRequests.append(qMakePair(i, pool->submit(filePath, i, size)));
+    }
+}
+
+void SpeculativeRenderer::collectThumbnails()
+{
+    if (pageSizeRequest) {
+        bool ready = false;
+        QList<QSizeF> sizes;
+        bool ok = pool->takePageSizesIfReady(pageSizeRequest, &ready, &sizes);
+        if (!ready)
+            return;
+
+        pageSizeRequest = 0;
+        if (!ok) {
+            qDebug() << "Speculative render could not load:" << filePath;
+            collectTimer->stop();
+            return;
+        }
+        workerSizes = sizes;
+        workerSizesKnown = true;
+        submitThumbnails(sizes);
+    }
+
+    while (!thumbnailRequests.isEmpty()) {
+        bool ready = false;
+        QImage image = pool->takeIfReady(thumbnailRequests.first().second, &ready);
+        if (!ready)
+            return;
+
+        const int pageIndex = thumbnailRequests.takeFirst().first;
+        if (!image.isNull())
+            emit thumbnailReady(pageIndex, image);
+    }
+    collectTimer->stop();
+}
+
+void SpeculativeRenderer::cancel()
+{
+    // Workers keep the document open after rendering thumbnails.
+    if (pool) {
+        collectTimer->stop();
+        thumbnailRequests.clear();
+        pageSizeRequest = 0;
+        pool->releaseDocuments();
+        pool = nullptr;
+    }
+
+    {
+        QMutexLocker locker(&mutex);
+        cancelled = true;
+        pages.clear();
+    }
+    changed.wakeAll();
+
+    // The thread holds the document open until run() returns, and callers
+    // delete the file right after cancelling, so wait for it here.
+    wait();
+    deleteLater();
+}
+
+void SpeculativeRenderer::run()
+{
+    QPdfDocument pdf;
+    if (pdf.load(filePath) != QPdfDocument::Error::None) {
+        qDebug() << "Speculative render could not load:" << filePath;
+        QMutexLocker locker(&mutex);
+        done = true;
+        changed.wakeAll();
+        return;
+    }
+
+    const int pageCount = pdf.pageCount();
+    {
+        QMutexLocker locker(&mutex);
+        pageLimit = qMin(pageCount, SpeculativePageCount);
+        changed.wakeAll();
+    }
+    emit pageCountKnown(pageCount);
+
+    for (int i = 0; i < qMin(pageCount, thumbnailCount); ++i) {
+        {
+            QMutexLocker locker(&mutex);
+            if (cancelled || printing)
+                break;
+        }
+        QSizeF pointSize = pdf.pagePointSize(i);
+        if (pointSize.height() <= 0)
+            continue;
+        QSize size(pointSize.width() * thumbnailHeight / pointSize.height(), thumbnailHeight);
+        emit thumbnailReady(i, pdf.render(i, size));
+    }
+
+    QMutexLocker locker(&mutex);
+    while (!cancelled) {
+        int next = -1;
+        if (resolution > 0) {
+            for (int i = 0; i < pageLimit; ++i) {
+                if (!renderedPages.contains(i)) {
+                    next = i;
+                    break;
+                }
+            }
+        }
+        if (next < 0) {
+            changed.wait(&mutex);
+            continue;
+        }
+
+        const int dpi = resolution;
+        const int startedGeneration = generation;
+        locker.unlock();
+
+        QSizeF pointSize = pdf.pagePointSize(next);
+        QImage image = pdf.render(next, QSize(pointSize.width() * dpi / 72.0, pointSize.height() * dpi / 72.0));
+
+        locker.relock();
+        if (generation == startedGeneration && !cancelled) {
+            pages.insert(next, image);
+            renderedPages.insert(next);
+            changed.wakeAll();
+        }
+    }
+
+    done = true;
+    changed.wakeAll();
+}
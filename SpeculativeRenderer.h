@@ -0,0 +1,78 @@
+#ifndef SPECULATIVERENDERER_H
+#define SPECULATIVERENDERER_H
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QHash>
+#include <QSet>
+#include <QImage>
+#include <QList>
+#include <QPair>
+#include "PdfPreflight.h"
+
+class QTimer;
+class RenderWorkerPool;
+
+// Renders preview thumbnails and the first full-resolution pages of a job
+// while the print options dialog is still open. Call cancel() instead of
+// deleting it; it waits for the thread to close the document, then schedules
+// the object for deletion.
+//
+// With the worker pool enabled, call startWithPool() instead of start(): the
+// thumbnails are then rendered by the workers and no full pages are kept.
+class SpeculativeRenderer : public QThread
+{
+    Q_OBJECT
+
+public:
+    SpeculativeRenderer(const QString &filePath, int thumbnailCount, int thumbnailHeight,
+                        QObject *parent = nullptr);
+    ~SpeculativeRenderer();
+
+    // 0 disables full-resolution pages; a new value discards the old ones.
+    void setResolution(int dpi);
+    QImage takePage(int pageIndex, const QSize &size);
+    void startWithPool(RenderWorkerPool *pool, const PdfPreflight::Info &preflight);
+    // Page sizes a worker reported in pool mode, so the print job does not
+    // have to ask again; false if they were not needed or are not known yet.
+    bool workerPageSizes(QList<QSizeF> *sizes) const;
+    void cancel();
+
+signals:
+    void pageCountKnown(int pageCount);
+    void thumbnailReady(int pageIndex, const QImage &image);
+
+protected:
+    void run() override;
+
+private slots:
+    void collectThumbnails();
+
+private:
+    void submitThumbnails(const QList<QSizeF> &sizes);
+
+    QString filePath;
+    int thumbnailCount;
+    int thumbnailHeight;
+
+    QMutex mutex;
+    QWaitCondition changed;
+    QHash<int, QImage> pages;
+    QSet<int> renderedPages;
+    int resolution;
+    int generation;
+    int pageLimit;
+    bool cancelled;
+    bool printing;
+    bool done;
+
+    RenderWorkerPool *pool;
+    QTimer *collectTimer;
+    QList<QPair<int, quint32>> thumbnailRequests;
+    quint32 pageSizeRequest;
+    QList<QSizeF> workerSizes;
+    bool workerSizesKnown;
+};
+
+#endif
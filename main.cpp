@@ -1,6 +1,9 @@
 #include "mainwindow.h"
 #include "LicenseDialog.h"
 #include "LicenseManager.h"
+#ifdef HAS_QTPDF
+#include "RenderWorkerPool.h"
+#endif
 #include <QApplication>
 #include <QSharedMemory>
 #include <QMessageBox>
@@ -9,6 +12,12 @@
 int main(int argc, char *argv[])
 {
     QApplication a(argc, argv);
+
+#ifdef HAS_QTPDF
+    if (RenderWorkerPool::isWorkerProcess(a.arguments()))
+        return RenderWorkerPool::runWorker(a.arguments());
+#endif
+
     a.setWindowIcon(QIcon(":/Logo.png"));
 
     QSharedMemory sharedMemory("QuantumPrint_SingleInstanceKey");